@@ -1,16 +1,30 @@
+//build: put parser.h and parser.c from the PA1 handout next to this file, then gcc -Wall -o sushell SUSHELL.c parser.c
+//tests: sh tests/script_mode.sh and sh tests/plan_cache.sh (they use the stand-in parser in tests/stub_parser)
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "parser.h"
+//turns a wait status into the exit code a shell would report for it
+static int exit_code(int status){
+    if(WIFEXITED(status)){
+        return WEXITSTATUS(status);
+    }
+    if(WIFSIGNALED(status)){
+        return 128+WTERMSIG(status);
+    }
+    return 1;
+}
 //function for executing a command without a loop
 //the paramaters are needed even if the STDIN_FILENO and STDOUT_FILENO are redirected,it is called by the loop pipe function.
-void execute_pipeline_internal(CmdVec command_sequence, int pipeline_input_fd, int pipeline_output_fd){
+//returns the exit code of the last command, like a shell pipeline.
+int execute_pipeline_internal(CmdVec command_sequence, int pipeline_input_fd, int pipeline_output_fd){
     int num_commands=command_sequence.n;
     if(num_commands<0){
-        return;
+        return 0;
     }
     pid_t pids[num_commands];
     int input_fd_for_current_cmd=pipeline_input_fd;
@@ -55,12 +69,16 @@ void execute_pipeline_internal(CmdVec command_sequence, int pipeline_input_fd, i
         }
     }
     //parent waits for fork calls to finish
+    int status=0;
     for (int i = 0; i < num_commands; i++) {
-        waitpid(pids[i], NULL, 0);
+        waitpid(pids[i], &status, 0);
     }
+    return num_commands>0?exit_code(status):0;
         }
 //function to execute internal logic n times,ite creates outer and internal pipes and the function itself cleans the outer pipe and readies it for next iteration
-void execute_loop_pipe(CmdVec pipeline_to_loop,int n_iterations){
+//returns the exit code of the last iteration
+int execute_loop_pipe(CmdVec pipeline_to_loop,int n_iterations){
+    int result=0;
     int input_for_iteration = STDIN_FILENO;
     int output_for_iteration;
     int p[2];
@@ -73,7 +91,7 @@ void execute_loop_pipe(CmdVec pipeline_to_loop,int n_iterations){
         pipe(p);
         output_for_iteration=p[1];
        }
-       execute_pipeline_internal(pipeline_to_loop, input_for_iteration, output_for_iteration);
+       result=execute_pipeline_internal(pipeline_to_loop, input_for_iteration, output_for_iteration);
        if(input_for_iteration!=STDIN_FILENO){
         close(input_for_iteration);
        }
@@ -84,6 +102,7 @@ void execute_loop_pipe(CmdVec pipeline_to_loop,int n_iterations){
         input_for_iteration=p[0];
        }
     }
+    return result;
 }
 
 typedef enum { STAGE_SIMPLE, STAGE_LOOP } StageType;
@@ -93,41 +112,56 @@ typedef struct {
     size_t loopLen;
 } PipelineStage;
 
-void execute_command(compiledCmd C){
-    int final_input_fd = STDIN_FILENO;
-    int final_output_fd = STDOUT_FILENO;  
-    if(C.inFile!=NULL){
-        final_input_fd=open(C.inFile, O_RDONLY);
-    }
-    if(C.outFile!=NULL){
-       final_output_fd = open(C.outFile, O_WRONLY | O_CREAT | O_TRUNC, 0644); 
-    }
-    PipelineStage stages_to_run[3];
+//fills stages_to_run with the before/loop/after parts of C that have commands, returns how many there are
+int build_stages(compiledCmd *C, PipelineStage stages_to_run[3]){
     int num_stages = 0;
-    if (C.before.n > 0) {
+    if (C->before.n > 0) {
         stages_to_run[num_stages].type = STAGE_SIMPLE;
-        stages_to_run[num_stages].commands = C.before;
+        stages_to_run[num_stages].commands = C->before;
         stages_to_run[num_stages].loopLen = 0;
         num_stages++;
     }
     
-    if (C.loopLen > 0 && C.inLoop.n > 0) { 
+    if (C->loopLen > 0 && C->inLoop.n > 0) { 
         stages_to_run[num_stages].type = STAGE_LOOP;
-        stages_to_run[num_stages].commands = C.inLoop;
-        stages_to_run[num_stages].loopLen = C.loopLen;
+        stages_to_run[num_stages].commands = C->inLoop;
+        stages_to_run[num_stages].loopLen = C->loopLen;
         num_stages++;
     }
     
-    if (C.after.n > 0) {
+    if (C->after.n > 0) {
         stages_to_run[num_stages].type = STAGE_SIMPLE;
-        stages_to_run[num_stages].commands = C.after;
+        stages_to_run[num_stages].commands = C->after;
         stages_to_run[num_stages].loopLen = 0;
         num_stages++;
     }
+    return num_stages;
+}
+
+//runs already built stages between the redirection files.
+//returns the exit code of the last stage, or 1 if a redirection file could not be opened
+int execute_stages(const char *inFile, const char *outFile, PipelineStage *stages_to_run, int num_stages){
+    int final_input_fd = STDIN_FILENO;
+    int final_output_fd = STDOUT_FILENO;  
+    if(inFile!=NULL){
+        final_input_fd=open(inFile, O_RDONLY);
+        if(final_input_fd<0){
+            perror(inFile);
+            return 1;
+        }
+    }
+    if(outFile!=NULL){
+       final_output_fd = open(outFile, O_WRONLY | O_CREAT | O_TRUNC, 0644); 
+       if(final_output_fd<0){
+            perror(outFile);
+            if (final_input_fd != STDIN_FILENO) close(final_input_fd);
+            return 1;
+       }
+    }
    if (num_stages == 0) {
         if (final_input_fd != STDIN_FILENO) close(final_input_fd);
         if (final_output_fd != STDOUT_FILENO) close(final_output_fd);
-        return;
+        return 0;
     }
     pid_t pids[num_stages];
     int input_fd_for_current_cmd = final_input_fd;
@@ -155,13 +189,14 @@ void execute_command(compiledCmd C){
                 close(p[0]);
             }
            PipelineStage *my_stage = &stages_to_run[i];
+           int result;
            if (my_stage->type == STAGE_LOOP) {
-                execute_loop_pipe(my_stage->commands, my_stage->loopLen);
+                result=execute_loop_pipe(my_stage->commands, my_stage->loopLen);
             } else {
-                execute_pipeline_internal(my_stage->commands, STDIN_FILENO, STDOUT_FILENO);
+                result=execute_pipeline_internal(my_stage->commands, STDIN_FILENO, STDOUT_FILENO);
             }
 
-            _exit(0);
+            _exit(result);
         }
         if (input_fd_for_current_cmd != final_input_fd) {
             close(input_fd_for_current_cmd);
@@ -173,8 +208,9 @@ void execute_command(compiledCmd C){
             input_fd_for_current_cmd = p[0];
         }
     } 
+    int status=0;
     for (int i = 0; i < num_stages; i++) {
-        waitpid(pids[i], NULL, 0);
+        waitpid(pids[i], &status, 0);
     }
     if (final_input_fd != STDIN_FILENO) {
         close(final_input_fd);
@@ -182,17 +218,765 @@ void execute_command(compiledCmd C){
     if (final_output_fd != STDOUT_FILENO) {
         close(final_output_fd);
     } 
+    return exit_code(status);
+}
+
+//plan cache: lines that were seen before skip parsing and reuse a flattened copy of their compiledCmd.
+//every plan lives in a single arena block so dropping it is one free.
+//the key leaves out the < and > targets, so "sort < a > b" and "sort < c > d" share one plan and the files
+//of each line are passed in when it runs. a line is keyed whole, targets included, when its targets are
+//quoted or repeated, or when the parser read them differently from split_redirects.
+//at most PLAN_CACHE_CAPACITY unpinned plans are kept, the least recently used one is dropped first.
+#define PLAN_CACHE_BUCKETS 1024   //initial size, doubled when there are twice as many plans as buckets
+#define PLAN_CACHE_CAPACITY 256
+
+typedef struct CachedPlan {
+    char *key;          //normalized line, without the redirection targets unless files_in_key is set
+    unsigned long hash;
+    compiledCmd cmd;    //argvs and file names point into arena, inFile and outFile are NULL unless files_in_key
+    int files_in_key;
+    char *arena;
+    PipelineStage stages[3];  //built once from cmd, so running the plan skips build_stages
+    int num_stages;
+    int pins;           //users that need the plan to stay, a pinned plan is off the LRU list
+    struct CachedPlan *next;      //bucket chain
+    struct CachedPlan *lru_prev;  //towards the most recently used plan
+    struct CachedPlan *lru_next;  //towards the least recently used plan
+} CachedPlan;
+
+typedef struct {
+    CachedPlan **buckets;
+    size_t num_buckets;
+    CachedPlan *lru_head;   //most recently used, only unpinned plans are on this list
+    CachedPlan *lru_tail;   //least recently used
+    size_t capacity;
+    size_t unpinned;        //length of the LRU list
+    size_t entries;
+    size_t hits;
+    size_t misses;
+    char *scratch;      //normalized form of the line being looked up, reused between lookups
+    size_t scratch_size;
+    char *shape;        //the same line without its redirection targets, NULL if it cannot be split
+    char *in_target;    //target of the line's <, NULL if it has none
+    char *out_target;   //target of the line's >
+} PlanCache;
+
+//redirection files for one run of a plan. they point into the cache and stay valid until the next lookup.
+typedef struct {
+    const char *inFile;
+    const char *outFile;
+} PlanFiles;
+
+static void initPlanCache(PlanCache *cache){
+    memset(cache,0,sizeof(PlanCache));
+    cache->capacity=PLAN_CACHE_CAPACITY;
+    cache->num_buckets=PLAN_CACHE_BUCKETS;
+    cache->buckets=calloc(cache->num_buckets,sizeof(CachedPlan *));
+}
+
+//pinned script plans can outnumber the capacity by far, so the table grows to keep chains short
+static void grow_buckets(PlanCache *cache){
+    size_t num_buckets=cache->num_buckets*2;
+    CachedPlan **buckets=calloc(num_buckets,sizeof(CachedPlan *));
+    for(size_t b=0;b<cache->num_buckets;b++){
+        CachedPlan *plan=cache->buckets[b];
+        while(plan!=NULL){
+            CachedPlan *next=plan->next;
+            plan->next=buckets[plan->hash%num_buckets];
+            buckets[plan->hash%num_buckets]=plan;
+            plan=next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets=buckets;
+    cache->num_buckets=num_buckets;
+}
+
+static void freePlanCache(PlanCache *cache){
+    for(size_t b=0;b<cache->num_buckets;b++){
+        CachedPlan *plan=cache->buckets[b];
+        while(plan!=NULL){
+            CachedPlan *next=plan->next;
+            free(plan->arena);
+            free(plan->key);
+            free(plan);
+            plan=next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets=NULL;
+    cache->num_buckets=0;
+    cache->lru_head=NULL;
+    cache->lru_tail=NULL;
+    cache->unpinned=0;
+    cache->entries=0;
+    free(cache->scratch);
+    cache->scratch=NULL;
+    cache->scratch_size=0;
+}
+
+//takes the < and > targets out of a normalized line: cache->shape gets the line without them and
+//cache->in_target/out_target get the targets. the line is left unsplit (shape NULL) when it has no
+//redirection, or when a target is empty, quoted or given twice, since the parser may read those otherwise.
+static void split_redirects(PlanCache *cache, const char *key, size_t size){
+    char *shape=cache->scratch+size;
+    char *in=shape+size;
+    char *out=in+size;
+    cache->shape=NULL;
+    cache->in_target=NULL;
+    cache->out_target=NULL;
+    size_t k=0;
+    char quote=0;
+    for(const char *c=key;*c!='\0';){
+        if(quote==0 && (*c=='<'||*c=='>')){
+            char *target=(*c=='<')?in:out;
+            char **slot=(*c=='<')?&cache->in_target:&cache->out_target;
+            if(*slot!=NULL){
+                return;
+            }
+            shape[k++]=*c++;
+            if(*c==' '){
+                shape[k++]=*c++;
+            }
+            size_t t=0;
+            while(*c!='\0' && *c!=' ' && *c!='<' && *c!='>' && *c!='|'){
+                if(*c=='"'||*c=='\''){
+                    return;
+                }
+                target[t++]=*c++;
+            }
+            if(t==0){
+                return;
+            }
+            target[t]='\0';
+            *slot=target;
+            continue;
+        }
+        if(quote==0 && (*c=='"'||*c=='\'')){
+            quote=*c;
+        }
+        else if(*c==quote){
+            quote=0;
+        }
+        shape[k++]=*c++;
+    }
+    shape[k]='\0';
+    if(cache->in_target!=NULL || cache->out_target!=NULL){
+        cache->shape=shape;
+    }
+}
+
+//trims the line and collapses runs of blanks outside quotes, so "ls  -l" and "ls -l " share a plan,
+//then splits off the redirection targets. everything goes into cache->scratch, which only grows when a
+//longer line than before comes in.
+static char *normalize_line(PlanCache *cache, const char *line){
+    size_t size=strlen(line)+1;
+    if(4*size>cache->scratch_size){
+        cache->scratch=realloc(cache->scratch,4*size);
+        cache->scratch_size=4*size;
+    }
+    char *key=cache->scratch;
+    size_t k=0;
+    char quote=0;
+    int pending_space=0;
+    for(const char *c=line;*c!='\0';c++){
+        if(quote==0 && (*c==' '||*c=='\t'||*c=='\n'||*c=='\r')){
+            pending_space=(k>0);
+            continue;
+        }
+        if(pending_space){
+            key[k++]=' ';
+            pending_space=0;
+        }
+        if(quote==0 && (*c=='"'||*c=='\'')){
+            quote=*c;
+        }
+        else if(*c==quote){
+            quote=0;
+        }
+        key[k++]=*c;
+    }
+    key[k]='\0';
+    split_redirects(cache,key,size);
+    return key;
+}
+
+static unsigned long hash_line(const char *key){
+    unsigned long h=14695981039346656037UL; //FNV-1a
+    for(const unsigned char *c=(const unsigned char *)key;*c!='\0';c++){
+        h^=*c;
+        h*=1099511628211UL;
+    }
+    return h;
+}
+
+static size_t vec_pointer_count(CmdVec *vec){
+    size_t count=vec->n;
+    for(int i=0;i<(int)vec->n;i++){
+        for(char **arg=vec->argvs[i];*arg!=NULL;arg++){
+            count++;
+        }
+        count++; //NULL terminator of argv
+    }
+    return count;
+}
+
+static size_t vec_string_bytes(CmdVec *vec){
+    size_t bytes=0;
+    for(int i=0;i<(int)vec->n;i++){
+        for(char **arg=vec->argvs[i];*arg!=NULL;arg++){
+            bytes+=strlen(*arg)+1;
+        }
+    }
+    return bytes;
+}
+
+static char *arena_copy_string(char **strings, const char *src){
+    if(src==NULL){
+        return NULL;
+    }
+    char *dst=*strings;
+    size_t n=strlen(src)+1;
+    memcpy(dst,src,n);
+    *strings+=n;
+    return dst;
+}
+
+//copies one CmdVec into the arena: the argv pointer tables go to *pointers, the words to *strings
+static void arena_copy_vec(CmdVec *dst, CmdVec *src, char ***pointers, char **strings){
+    *dst=*src;
+    if(src->n==0){
+        dst->argvs=NULL;
+        return;
+    }
+    dst->argvs=(char ***)*pointers;
+    *pointers+=src->n;
+    for(int i=0;i<(int)src->n;i++){
+        char **argv_copy=*pointers;
+        int a=0;
+        for(char **arg=src->argvs[i];*arg!=NULL;arg++){
+            argv_copy[a++]=arena_copy_string(strings,*arg);
+        }
+        argv_copy[a++]=NULL;
+        *pointers+=a;
+        dst->argvs[i]=argv_copy;
+    }
+}
+
+//builds a plan whose every pointer lives in one malloc'd block, the parser's copy can be freed afterwards
+static void flatten_plan(CachedPlan *plan, compiledCmd *src){
+    size_t num_pointers=vec_pointer_count(&src->before)+vec_pointer_count(&src->inLoop)+vec_pointer_count(&src->after);
+    size_t num_bytes=vec_string_bytes(&src->before)+vec_string_bytes(&src->inLoop)+vec_string_bytes(&src->after);
+    if(src->inFile!=NULL){
+        num_bytes+=strlen(src->inFile)+1;
+    }
+    if(src->outFile!=NULL){
+        num_bytes+=strlen(src->outFile)+1;
+    }
+    plan->arena=malloc(num_pointers*sizeof(char *)+num_bytes+1);
+    char **pointers=(char **)plan->arena;
+    char *strings=plan->arena+num_pointers*sizeof(char *);
+    plan->cmd=*src;
+    arena_copy_vec(&plan->cmd.before,&src->before,&pointers,&strings);
+    arena_copy_vec(&plan->cmd.inLoop,&src->inLoop,&pointers,&strings);
+    arena_copy_vec(&plan->cmd.after,&src->after,&pointers,&strings);
+    plan->cmd.inFile=arena_copy_string(&strings,src->inFile);
+    plan->cmd.outFile=arena_copy_string(&strings,src->outFile);
+}
+
+static void lru_unlink(PlanCache *cache, CachedPlan *plan){
+    if(plan->lru_prev!=NULL){
+        plan->lru_prev->lru_next=plan->lru_next;
+    }
+    else{
+        cache->lru_head=plan->lru_next;
+    }
+    if(plan->lru_next!=NULL){
+        plan->lru_next->lru_prev=plan->lru_prev;
+    }
+    else{
+        cache->lru_tail=plan->lru_prev;
+    }
+    plan->lru_prev=NULL;
+    plan->lru_next=NULL;
+    cache->unpinned--;
+}
+
+static void lru_push_front(PlanCache *cache, CachedPlan *plan){
+    plan->lru_prev=NULL;
+    plan->lru_next=cache->lru_head;
+    if(cache->lru_head!=NULL){
+        cache->lru_head->lru_prev=plan;
+    }
+    cache->lru_head=plan;
+    if(cache->lru_tail==NULL){
+        cache->lru_tail=plan;
+    }
+    cache->unpinned++;
+}
+
+static void drop_plan(PlanCache *cache, CachedPlan *plan){
+    CachedPlan **link=&cache->buckets[plan->hash%cache->num_buckets];
+    while(*link!=plan){
+        link=&(*link)->next;
+    }
+    *link=plan->next;
+    lru_unlink(cache,plan);
+    free(plan->arena);
+    free(plan->key);
+    free(plan);
+    cache->entries--;
+}
+
+//drops least recently used plans until at most capacity unpinned plans are left.
+//pinned plans are not on the list, so every plan looked at here can be dropped.
+static void evict_plans(PlanCache *cache){
+    while(cache->unpinned>cache->capacity){
+        drop_plan(cache,cache->lru_tail);
+    }
+}
+
+static CachedPlan *find_plan(PlanCache *cache, const char *key, unsigned long hash){
+    for(CachedPlan *plan=cache->buckets[hash%cache->num_buckets];plan!=NULL;plan=plan->next){
+        if(plan->hash==hash && strcmp(plan->key,key)==0){
+            return plan;
+        }
+    }
+    return NULL;
+}
+
+static int same_target(const char *a, const char *b){
+    return (a==NULL && b==NULL) || (a!=NULL && b!=NULL && strcmp(a,b)==0);
+}
+
+//returns the plan for the line, compiling it only the first time it is seen, and puts the line's
+//redirection files in *files. the plan is owned by the cache, callers must not free it. an unpinned plan
+//is only valid until the next call into the cache; with pin set it stays until releasePlan, which script
+//mode needs because it keeps every line's plan until the whole script has run.
+static CachedPlan *getCompiledPlan(PlanCache *cache, sparser_t *parser, const char *line, int pin, PlanFiles *files){
+    char *key=normalize_line(cache,line);
+    char *shape=cache->shape;
+    unsigned long shape_hash=shape?hash_line(shape):0;
+    CachedPlan *plan=shape?find_plan(cache,shape,shape_hash):NULL;
+    unsigned long hash=0;
+    if(plan==NULL){
+        hash=hash_line(key);
+        plan=find_plan(cache,key,hash);
+    }
+    if(plan!=NULL){
+        cache->hits++;
+        if(plan->pins==0){
+            lru_unlink(cache,plan);
+            if(!pin){
+                lru_push_front(cache,plan);
+            }
+        }
+        plan->pins+=pin;
+    }
+    else{
+        cache->misses++;
+        compiledCmd C;
+        compileCommand(parser,line,&C);
+        plan=malloc(sizeof(CachedPlan));
+        //the targets only leave the key if the parser found exactly the ones split_redirects did
+        plan->files_in_key=(shape==NULL || !same_target(C.inFile,cache->in_target)
+                                        || !same_target(C.outFile,cache->out_target));
+        compiledCmd kept=C;
+        if(!plan->files_in_key){
+            kept.inFile=NULL;
+            kept.outFile=NULL;
+            hash=shape_hash;
+        }
+        plan->key=strdup(plan->files_in_key?key:shape);
+        plan->hash=hash;
+        plan->pins=pin;
+        flatten_plan(plan,&kept);
+        freeCompiledCmd(&C);
+        plan->num_stages=build_stages(&plan->cmd,plan->stages);
+        if(cache->entries>=2*cache->num_buckets){
+            grow_buckets(cache);
+        }
+        CachedPlan **bucket=&cache->buckets[hash%cache->num_buckets];
+        plan->next=*bucket;
+        *bucket=plan;
+        plan->lru_prev=NULL;
+        plan->lru_next=NULL;
+        cache->entries++;
+        if(!pin){
+            lru_push_front(cache,plan);
+            evict_plans(cache);
+        }
+    }
+    if(plan->files_in_key){
+        files->inFile=plan->cmd.inFile;
+        files->outFile=plan->cmd.outFile;
+    }
+    else{
+        files->inFile=cache->in_target;
+        files->outFile=cache->out_target;
+    }
+    return plan;
+}
+
+static int execute_plan(CachedPlan *plan, const PlanFiles *files){
+    return execute_stages(files->inFile,files->outFile,plan->stages,plan->num_stages);
+}
+
+//undoes one pinned getCompiledPlan, the plan may be evicted from now on
+static void releasePlan(PlanCache *cache, CachedPlan *plan){
+    plan->pins--;
+    if(plan->pins==0){
+        lru_push_front(cache,plan);
+        evict_plans(cache);
+    }
+}
+
+static void print_cache_counts(FILE *out, size_t hits, size_t misses, size_t entries){
+    size_t lookups=hits+misses;
+    fprintf(out,"plan cache: %zu hits, %zu misses (%.1f%% hit rate), %zu plans\n",
+            hits,misses,lookups?100.0*hits/lookups:0.0,entries);
+}
+
+static void printPlanCacheStats(PlanCache *cache, FILE *out){
+    print_cache_counts(out,cache->hits,cache->misses,cache->entries);
+}
+
+//a line containing only this word makes the script wait for every earlier line before going on.
+//lines are ordered by their < and > files only, compared after resolve_path. a file reached through a
+//hard link, a dangling symlink, or a directory the script itself creates can still look independent,
+//and so can a file a command opens on its own; put a barrier before lines like these.
+#define SCRIPT_BARRIER "barrier"
+//builtin in both modes: prints the plan cache counters. in a script it also acts as a barrier, so the
+//output comes after the lines above it, and it shows the counters as they were when the line was compiled.
+#define BUILTIN_CACHESTATS "cachestats"
+
+typedef struct {
+    CachedPlan *plan;   //pinned in the plan cache until the script is done
+    compiledCmd *cmd;   //&plan->cmd
+    PlanFiles files;    //this line's own copies of its redirection files
+    char *in_path;   //resolved files.inFile, NULL without input redirection
+    char *out_path;  //resolved files.outFile
+    int is_barrier;
+    int is_cachestats;  //a barrier that prints the counters below when it is reached
+    size_t stats_hits;
+    size_t stats_misses;
+    size_t stats_entries;
+    int lineno;  //line number in the script file, for error messages
+    int *deps;   //indexes of every earlier line (since the last barrier) this one must wait for
+    int num_deps;
+    pid_t pid;
+    int status;
+    int started;
+    int done;
+} ScriptLine;
+
+//true if the line is only the given word, surrounded by blanks
+static int is_word_line(const char *line, const char *word){
+    while(*line==' '||*line=='\t'){
+        line++;
+    }
+    size_t n=strlen(word);
+    if(strncmp(line,word,n)!=0){
+        return 0;
+    }
+    line+=n;
+    while(*line==' '||*line=='\t'||*line=='\n'||*line=='\r'){
+        line++;
+    }
+    return *line=='\0';
+}
+
+static int is_blank_line(const char *line){
+    while(*line==' '||*line=='\t'||*line=='\n'||*line=='\r'){
+        line++;
+    }
+    return *line=='\0';
+}
+
+//makes an absolute path with no ".", ".." or symlinks in the directory part, so "out", "./out" and
+//"dir/../out" compare equal. the file itself does not have to exist, an output file usually does not yet.
+static char *resolve_path(const char *path){
+    if(path==NULL){
+        return NULL;
+    }
+    char *resolved=realpath(path,NULL);
+    if(resolved!=NULL){
+        return resolved;
+    }
+    const char *slash=strrchr(path,'/');
+    const char *base=slash?slash+1:path;
+    char *dir;
+    if(slash==NULL){
+        dir=realpath(".",NULL);
+    }
+    else if(slash==path){
+        dir=realpath("/",NULL);
+    }
+    else{
+        char *dir_part=strndup(path,slash-path);
+        dir=realpath(dir_part,NULL);
+        free(dir_part);
+    }
+    if(dir==NULL){
+        return strdup(path); //the directory does not exist either, compare the path as written
+    }
+    size_t dir_len=strlen(dir);
+    resolved=malloc(dir_len+strlen(base)+2);
+    sprintf(resolved,"%s%s%s",dir,(dir_len>0 && dir[dir_len-1]=='/')?"":"/",base);
+    free(dir);
+    return resolved;
+}
+
+static int same_file(const char *a, const char *b){
+    return a!=NULL && b!=NULL && strcmp(a,b)==0;
+}
 
+//two lines depend on each other if they write the same file or one reads what the other writes
+static int lines_conflict(ScriptLine *earlier, ScriptLine *later){
+    return same_file(earlier->out_path, later->out_path)
+        || same_file(earlier->out_path, later->in_path)
+        || same_file(earlier->in_path, later->out_path);
 }
-int main(void) {
+
+static int deps_done(ScriptLine *lines, ScriptLine *cur){
+    for(int d=0;d<cur->num_deps;d++){
+        if(!lines[cur->deps[d]].done){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//waits for one running line and marks it as finished, returns -1 if nothing was running
+static int reap_script_line(ScriptLine *lines, int num_lines){
+    int status;
+    pid_t pid=waitpid(-1,&status,0);
+    if(pid<0){
+        return -1;
+    }
+    for(int i=0;i<num_lines;i++){
+        if(lines[i].pid==pid){
+            lines[i].status=exit_code(status);
+            lines[i].done=1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+//runs every line of the script file, at most max_jobs lines at the same time.
+//all lines are compiled first so the dependencies between them are known before anything starts.
+//returns 0 if every line succeeded and 1 otherwise.
+int run_script(PlanCache *cache, sparser_t *parser, FILE *script, int max_jobs){
+    ScriptLine *lines=NULL;
+    int num_lines=0;
+    int capacity=0;
+    char *line=NULL;
+    size_t len=0;
+    int lineno=0;
+    while(getline(&line,&len,script)!=-1){
+        lineno++;
+        if(is_blank_line(line)){
+            continue;
+        }
+        if(num_lines==capacity){
+            capacity=capacity?capacity*2:64;
+            lines=realloc(lines,capacity*sizeof(ScriptLine));
+        }
+        ScriptLine *cur=&lines[num_lines];
+        memset(cur,0,sizeof(ScriptLine));
+        cur->lineno=lineno;
+        if(is_word_line(line,SCRIPT_BARRIER)){
+            cur->is_barrier=1;
+            num_lines++;
+            continue;
+        }
+        if(is_word_line(line,BUILTIN_CACHESTATS)){
+            cur->is_barrier=1;
+            cur->is_cachestats=1;
+            cur->stats_hits=cache->hits;
+            cur->stats_misses=cache->misses;
+            cur->stats_entries=cache->entries;
+            num_lines++;
+            continue;
+        }
+        cur->plan=getCompiledPlan(cache,parser,line,1,&cur->files);
+        cur->cmd=&cur->plan->cmd;
+        if(cur->cmd->isQuit){
+            releasePlan(cache,cur->plan);
+            break;
+        }
+        //the files point into the cache until the next lookup, so the line keeps its own copies
+        cur->files.inFile=cur->files.inFile?strdup(cur->files.inFile):NULL;
+        cur->files.outFile=cur->files.outFile?strdup(cur->files.outFile):NULL;
+        cur->in_path=resolve_path(cur->files.inFile);
+        cur->out_path=resolve_path(cur->files.outFile);
+        //conflicts are not transitive ("a > x", "b > y", "c < y > x"), so every conflicting line is kept
+        for(int j=num_lines-1;j>=0;j--){
+            if(lines[j].is_barrier){
+                break;
+            }
+            if(lines_conflict(&lines[j],cur)){
+                cur->deps=realloc(cur->deps,(cur->num_deps+1)*sizeof(int));
+                cur->deps[cur->num_deps++]=j;
+            }
+        }
+        num_lines++;
+    }
+    free(line);
+
+    int running=0;
+    int finished=0;
+    int first_pending=0;
+    while(finished<num_lines){
+        //start every line that is ready, a blocked line does not hold back the independent ones after it
+        int progress=0;
+        for(int i=first_pending;i<num_lines && running<max_jobs;i++){
+            ScriptLine *cur=&lines[i];
+            if(cur->started){
+                continue;
+            }
+            if(cur->is_barrier){
+                if(finished<i){
+                    break; //nothing after a barrier may start before everything above it is done
+                }
+                if(cur->is_cachestats){
+                    print_cache_counts(stdout,cur->stats_hits,cur->stats_misses,cur->stats_entries);
+                    fflush(stdout);
+                }
+                cur->started=1;
+                cur->done=1;
+                finished++;
+                progress=1;
+                continue;
+            }
+            if(!deps_done(lines,cur)){
+                continue;
+            }
+            fflush(stdout);
+            cur->started=1;
+            cur->pid=fork();
+            if(cur->pid==0){
+                _exit(execute_plan(cur->plan,&cur->files));
+            }
+            running++;
+            progress=1;
+        }
+        while(first_pending<num_lines && lines[first_pending].started){
+            first_pending++;
+        }
+        if(!progress){
+            if(reap_script_line(lines,num_lines)<0){
+                break;
+            }
+            running--;
+            finished++;
+        }
+    }
+
+    int failed=0;
+    for(int i=0;i<num_lines;i++){
+        if(lines[i].status!=0){
+            fprintf(stderr,"line %d failed with exit code %d\n",lines[i].lineno,lines[i].status);
+            failed=1;
+        }
+        if(lines[i].plan!=NULL){
+            releasePlan(cache,lines[i].plan);
+        }
+        free((char *)lines[i].files.inFile);
+        free((char *)lines[i].files.outFile);
+        free(lines[i].in_path);
+        free(lines[i].out_path);
+        free(lines[i].deps);
+    }
+    free(lines);
+    return failed;
+}
+
+static void print_usage(const char *prog){
+    fprintf(stderr,"usage: %s [-j N] [-s] [file]\n",prog);
+    fprintf(stderr,"  file  run the commands in file instead of reading stdin\n");
+    fprintf(stderr,"  -j N  run up to N independent script lines at the same time (1 <= N <= 4096), needs a file\n");
+    fprintf(stderr,"  -s    print plan cache statistics to stderr at the end\n");
+}
+
+//reads a positive job count, returns 0 if the text is not one
+static int parse_job_count(const char *text){
+    char *end;
+    long n=strtol(text,&end,10);
+    if(end==text || *end!='\0' || n<1 || n>4096){
+        return 0;
+    }
+    return (int)n;
+}
+
+int main(int argc, char *argv[]) {
     
+    int max_jobs=1;
+    int show_stats=0;
+    int jobs_given=0;
+    const char *script_path=NULL;
+    for(int i=1;i<argc;i++){
+        if(strcmp(argv[i],"-j")==0){
+            if(i+1>=argc || (max_jobs=parse_job_count(argv[++i]))==0){
+                fprintf(stderr,"%s: -j needs a job count between 1 and 4096\n",argv[0]);
+                print_usage(argv[0]);
+                return 2;
+            }
+            jobs_given=1;
+        }
+        else if(strcmp(argv[i],"-s")==0){
+            show_stats=1;
+        }
+        else if(argv[i][0]=='-'){
+            fprintf(stderr,"%s: unknown option %s\n",argv[0],argv[i]);
+            print_usage(argv[0]);
+            return 2;
+        }
+        else if(script_path!=NULL){
+            fprintf(stderr,"%s: only one script file can be given\n",argv[0]);
+            print_usage(argv[0]);
+            return 2;
+        }
+        else{
+            script_path=argv[i];
+        }
+    }
+
+    if(jobs_given && script_path==NULL){
+        fprintf(stderr,"%s: -j only applies to script files\n",argv[0]);
+        print_usage(argv[0]);
+        return 2;
+    }
+
     sparser_t parser;
     initParser(&parser);
+    PlanCache cache;
+    initPlanCache(&cache);
+
+    if(script_path!=NULL){
+        FILE *script=fopen(script_path,"r");
+        if(script==NULL){
+            perror(script_path);
+            freePlanCache(&cache);
+            freeParser(&parser);
+            return 1;
+        }
+        int result=run_script(&cache,&parser,script,max_jobs);
+        fclose(script);
+        if(show_stats){
+            printPlanCacheStats(&cache,stderr);
+        }
+        freePlanCache(&cache);
+        freeParser(&parser);
+        return result;
+    }
     
     char *line = NULL;
     size_t len = 0;
     ssize_t nread;
-    compiledCmd C;
+    CachedPlan *plan;
+    PlanFiles files;
 
     while (1) {
         printf("SUShell$ ");
@@ -204,20 +988,27 @@ int main(void) {
             break;
         }
 
-        compileCommand(&parser, line, &C);
+        //builtin, not sent to the parser
+        if (is_word_line(line, BUILTIN_CACHESTATS)) {
+            printPlanCacheStats(&cache, stdout);
+            continue;
+        }
+
+        plan = getCompiledPlan(&cache, &parser, line, 0, &files);
 
-        if (C.isQuit) {
+        if (plan->cmd.isQuit) {
             printf("Exiting shell...\n");
-            freeCompiledCmd(&C);
-            free(line);
             break;
         }
 
-        execute_command(C);
-
-        freeCompiledCmd(&C);
+        execute_plan(plan, &files);
 
     }
+    free(line);
+    if (show_stats) {
+        printPlanCacheStats(&cache, stderr);
+    }
+    freePlanCache(&cache);
     freeParser(&parser);
     return 0;
 }
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Plan cache tests for SUSHELL.
+# Builds SUSHELL.c against tests/stub_parser and checks the hit counts reported by -s and cachestats.
+# Run from the repository root: sh tests/plan_cache.sh
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+gcc -Wall -Wextra -I"$ROOT/tests/stub_parser" -o "$WORK/sushell" \
+    "$ROOT/SUSHELL.c" "$ROOT/tests/stub_parser/parser.c" || exit 1
+cd "$WORK" || exit 1
+
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "PASS: $1"
+    else
+        echo "FAIL: $1 (expected '$3', got '$2')"
+        FAILED=1
+    fi
+}
+
+# repeated lines are compiled once, blanks do not change the key
+printf 'true a\ntrue  a\n  true a \ntrue b\n' > repeat.txt
+check "repeated lines hit the cache" "$(./sushell -s repeat.txt 2>&1)" \
+    "plan cache: 2 hits, 2 misses (50.0% hit rate), 2 plans"
+
+# redirect targets are not part of the key, each line still reads and writes its own files
+printf 'cat < in1 > out1\ncat < in2 > out2\ncat  <  in3 > out3\n' > redirect.txt
+echo one > in1
+echo two > in2
+echo three > in3
+check "different files share a plan" "$(./sushell -s -j 4 redirect.txt 2>&1)" \
+    "plan cache: 2 hits, 1 misses (66.7% hit rate), 1 plans"
+check "each line uses its own files" "$(cat out1 out2 out3)" "$(printf 'one\ntwo\nthree')"
+
+# a line with only some of the redirections has its own plan
+printf 'cat < in1 > out4\ncat < in2\n' > partial.txt
+check "different redirections give different plans" "$(./sushell -s partial.txt 2>&1 | tail -1)" \
+    "plan cache: 0 hits, 2 misses (0.0% hit rate), 2 plans"
+
+# cachestats is a builtin in scripts too and shows the counters at that line
+printf 'true\ntrue\ncachestats\ntrue\n' > stats.txt
+check "cachestats in a script" "$(./sushell stats.txt)" \
+    "plan cache: 1 hits, 1 misses (50.0% hit rate), 1 plans"
+
+# cachestats in the interactive loop
+OUT=$(printf 'true\ntrue\ncachestats\nquit\n' | ./sushell | grep "plan cache")
+check "cachestats in the interactive loop" "$OUT" \
+    "SUShell\$ SUShell\$ SUShell\$ plan cache: 1 hits, 1 misses (50.0% hit rate), 1 plans"
+
+# the interactive cache keeps at most 256 plans, the least recently used one goes first
+OUT=$( (i=1; while [ $i -le 300 ]; do echo "true $i"; i=$((i + 1)); done
+        echo "true 300"; echo "true 1"; echo cachestats; echo quit) | ./sushell | grep -o "plan cache.*")
+check "interactive cache is bounded" "$OUT" \
+    "plan cache: 1 hits, 301 misses (0.3% hit rate), 256 plans"
+
+# script mode pins more plans than the capacity while it runs and shrinks back afterwards
+i=1; while [ $i -le 300 ]; do echo "true $i"; i=$((i + 1)); done > many.txt
+cat many.txt many.txt > twice.txt
+check "script plans are pinned until the end" "$(./sushell -s -j 8 twice.txt 2>&1)" \
+    "plan cache: 300 hits, 300 misses (50.0% hit rate), 256 plans"
+
+exit $FAILED
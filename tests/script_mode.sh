@@ -0,0 +1,89 @@
+#!/bin/sh
+# Script mode tests for SUSHELL.
+# Builds SUSHELL.c against tests/stub_parser and runs small scripts in a temporary directory.
+# Run from the repository root: sh tests/script_mode.sh
+# To build the real shell, put parser.h and parser.c from the PA1 handout next to SUSHELL.c and run
+#   gcc -Wall -o sushell SUSHELL.c parser.c
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+gcc -Wall -Wextra -I"$ROOT/tests/stub_parser" -o "$WORK/sushell" \
+    "$ROOT/SUSHELL.c" "$ROOT/tests/stub_parser/parser.c" || exit 1
+cd "$WORK" || exit 1
+
+# slow WORD: prints WORD after a second, so a line that is not waited for would finish first
+printf '#!/bin/sh\nsleep 1\necho "$1"\n' > slow
+# waitfor FILE: prints "seen" once FILE exists, or "timeout" after ten seconds
+printf '#!/bin/sh\nfor i in $(seq 100); do [ -e "$1" ] && echo seen && exit 0; sleep 0.1; done\necho timeout\n' > waitfor
+# running ID: counts how many running jobs exist while this one runs, into count.ID
+printf '#!/bin/sh\nid=$1\ntouch "run.$id"\nsleep 0.2\nset -- run.*\necho $# > "count.$id"\nsleep 0.2\nrm "run.$id"\n' > running
+# meet N ID: prints "met" once N jobs have called meet at the same time, or "timeout" after ten seconds
+printf '#!/bin/sh\ntouch "met.$2"\nfor i in $(seq 100); do set -- "$1" met.*; [ $(($# - 1)) -ge "$1" ] && echo met && exit 0; sleep 0.1; done\necho timeout\n' > meet
+chmod +x slow waitfor running meet
+
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "PASS: $1"
+    else
+        echo "FAIL: $1 (expected '$3', got '$2')"
+        FAILED=1
+    fi
+}
+
+# a later line writing the same file must run after the earlier one
+printf './slow a > out\necho b > out\n' > shared.txt
+./sushell -j 4 shared.txt
+check "shared output file keeps line order" "$(cat out)" "b"
+
+# the same file written through different paths is still ordered
+mkdir sub
+printf './slow a > same\necho b > ./same\n./slow c > sub/../other\necho d > other\n' > paths.txt
+./sushell -j 4 paths.txt
+check "./same and same are one file" "$(cat same)" "b"
+check "sub/../other and other are one file" "$(cat other)" "d"
+
+# line 3 conflicts with both earlier lines, which do not conflict with each other
+printf './slow a > x\necho b > y\ncat < y > x\n' > transitive.txt
+./sushell -j 4 transitive.txt
+check "line waits for every conflicting line" "$(cat x)" "b"
+
+# nothing after a barrier starts before the lines above it are done
+printf './slow a > before\nbarrier\ncat before > after\n' > barrier.txt
+./sushell -j 4 barrier.txt
+check "barrier waits for earlier lines" "$(cat after)" "a"
+
+# a blocked line does not hold back independent lines after it: line 1 only sees r if line 3
+# runs while line 2 is still waiting for line 1
+printf './waitfor r > p\ncat < p > q\necho free > r\n' > ready.txt
+./sushell -j 4 ready.txt
+check "independent line runs while a dependent one waits" "$(cat q)" "seen"
+
+# -j limits how many lines run at once, every job records how many were running with it
+printf './running 1\n./running 2\n./running 3\n./running 4\n./running 5\n./running 6\n' > limit.txt
+./sushell -j 2 limit.txt
+check "-j 2 runs at most two lines at a time" "$(cat count.* | sort -n | tail -1)" "2"
+# four lines that each wait for all four only finish if they run together
+printf './meet 4 1\n./meet 4 2\n./meet 4 3\n./meet 4 4\n' > meet.txt
+check "-j 4 runs four lines at a time" "$(./sushell -j 4 meet.txt | sort -u)" "met"
+
+# a failing line makes the whole script fail
+printf 'true\nfalse\n' > fail.txt
+./sushell fail.txt 2> /dev/null
+check "failed line gives a non-zero exit code" "$?" "1"
+printf 'true\n' > ok.txt
+./sushell ok.txt
+check "successful script exits with 0" "$?" "0"
+
+./sushell -j 2> /dev/null
+check "-j without a value is rejected" "$?" "2"
+./sushell -j foo ok.txt 2> /dev/null
+check "-j with a bad value is rejected" "$?" "2"
+./sushell -j 2 < ok.txt 2> /dev/null
+check "-j without a script file is rejected" "$?" "2"
+./sushell ok.txt fail.txt 2> /dev/null
+check "second script file is rejected" "$?" "2"
+
+exit $FAILED
@@ -0,0 +1,62 @@
+#include <stdlib.h>
+#include <string.h>
+#include "parser.h"
+
+void initParser(sparser_t *parser){
+    parser->unused=0;
+}
+
+void freeParser(sparser_t *parser){
+    (void)parser;
+}
+
+//a single command goes into C->before, pipes and loops are not supported
+void compileCommand(sparser_t *parser, const char *line, compiledCmd *C){
+    (void)parser;
+    memset(C,0,sizeof(compiledCmd));
+    char *copy=strdup(line);
+    char **argv=calloc(strlen(line)/2+2,sizeof(char *));
+    int argc=0;
+    for(char *word=strtok(copy," \t\r\n");word!=NULL;word=strtok(NULL," \t\r\n")){
+        if(strcmp(word,"quit")==0 && argc==0){
+            C->isQuit=1;
+        }
+        else if(strcmp(word,"<")==0 || strcmp(word,">")==0){
+            char *file=strtok(NULL," \t\r\n");
+            if(file!=NULL){
+                if(word[0]=='<'){
+                    free(C->inFile);
+                    C->inFile=strdup(file);
+                }
+                else{
+                    free(C->outFile);
+                    C->outFile=strdup(file);
+                }
+            }
+        }
+        else{
+            argv[argc++]=strdup(word);
+        }
+    }
+    free(copy);
+    if(argc==0){
+        free(argv);
+        return;
+    }
+    C->before.argvs=malloc(sizeof(char **));
+    C->before.argvs[0]=argv;
+    C->before.n=1;
+}
+
+void freeCompiledCmd(compiledCmd *C){
+    for(size_t i=0;i<C->before.n;i++){
+        for(char **arg=C->before.argvs[i];*arg!=NULL;arg++){
+            free(*arg);
+        }
+        free(C->before.argvs[i]);
+    }
+    free(C->before.argvs);
+    free(C->inFile);
+    free(C->outFile);
+    memset(C,0,sizeof(compiledCmd));
+}
@@ -0,0 +1,30 @@
+//test-only stand-in for the parser that comes with the PA1 handout (parser.h/parser.c are not in this repo).
+//it only knows plain words, "< file", "> file" and "quit", which is enough to drive script mode in the tests.
+#ifndef STUB_PARSER_H
+#define STUB_PARSER_H
+#include <stddef.h>
+
+typedef struct {
+    char ***argvs;  //argvs[i] is the NULL terminated argv of command i
+    size_t n;
+} CmdVec;
+
+typedef struct {
+    CmdVec before;
+    CmdVec inLoop;
+    CmdVec after;
+    size_t loopLen;
+    char *inFile;
+    char *outFile;
+    int isQuit;
+} compiledCmd;
+
+typedef struct {
+    int unused;
+} sparser_t;
+
+void initParser(sparser_t *parser);
+void freeParser(sparser_t *parser);
+void compileCommand(sparser_t *parser, const char *line, compiledCmd *C);
+void freeCompiledCmd(compiledCmd *C);
+#endif